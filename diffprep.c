@@ -13,6 +13,44 @@ static char const version_info[]=
    #define CONFIG_NO_LOCALE 0
 #endif
 
+/* User configuration option: Include "-D CONFIG_POSIX=0" in your CFLAGS in
+ * order to build a version which only uses the ANSI C runtime library even on
+ * a POSIX system. Otherwise, option -u will use POSIX features for reducing
+ * the output latency where they are available, and files will be positioned
+ * with off_t offsets which are not limited to LONG_MAX. */
+#ifndef CONFIG_POSIX
+   #if defined __unix__ || defined __unix || defined __APPLE__
+      #define CONFIG_POSIX 1
+   #else
+      #define CONFIG_POSIX 0
+   #endif
+#endif
+#if CONFIG_POSIX && !defined _POSIX_C_SOURCE
+   #define _POSIX_C_SOURCE 200112L
+#endif
+#if CONFIG_POSIX && !defined _FILE_OFFSET_BITS
+   #define _FILE_OFFSET_BITS 64
+#endif
+
+/* User configuration options: The conversion result cache enabled by option
+ * -k holds at most CONFIG_CACHE_ENTRIES entries, unless the option specifies
+ * a different number. They are organized in sets of CONFIG_CACHE_WAYS
+ * entries each, and results larger than CONFIG_CACHE_MAX_ENTRY bytes will
+ * not be cached. */
+#ifndef CONFIG_CACHE_ENTRIES
+   #define CONFIG_CACHE_ENTRIES 4096
+#endif
+#ifndef CONFIG_CACHE_WAYS
+   #define CONFIG_CACHE_WAYS 4
+#endif
+#ifndef CONFIG_CACHE_MAX_ENTRY
+   #define CONFIG_CACHE_MAX_ENTRY 16777216L
+#endif
+
+/* Expands <macro> and turns the result into a string literal. */
+#define STRINGIFY(macro) STRINGIFY_EXPANDED(macro)
+#define STRINGIFY_EXPANDED(text) #text
+
 static char const *const help[]= {
    "Usage: $APPLICATION_NAME [ <options> ... [--] ] [ <input_file> ]\n"
    "\n"
@@ -121,6 +159,91 @@ static char const *const help[]= {
    "    original format; only the values at the left side of the dump will\n"
    "    be processed.\n"
    "\n"
+   ,
+   "-r <size>[:<fields>]: Make -x and -b treat the input as a sequence of\n"
+   "    records of <size> bytes each, of which only the bytes of the\n"
+   "    selected fields will be dumped. <fields> is a comma-separated list\n"
+   "    of byte offsets within a record, or of ranges <first>-<last> of\n"
+   "    such offsets, in ascending order. For instance, '-r 3:1' selects\n"
+   "    only the green channel of 24-bit RGB pixels. Without <fields>, all\n"
+   "    bytes of a record are selected.\n"
+   "\n"
+   "-p <prefix>: Make -x and -b dump every field selected by -r into a\n"
+   "    separate file rather than to the output, named <prefix> followed\n"
+   "    by the 1-based number of the field. The input file needs to be\n"
+   "    seekable, because it is read once for every field.\n"
+   "\n"
+   "-m <records_file>: Make -X and -B merge the decoded bytes into the\n"
+   "    bytes selected by -r of the records read from <records_file>,\n"
+   "    and output the resulting records. All other bytes are copied\n"
+   "    unchanged. It is an error if the number of decoded bytes differs\n"
+   "    from the number of selected bytes.\n"
+   "\n"
+   "-d <old_file>: Compare the input with <old_file> byte by byte, similar\n"
+   "    to diffing the outputs of -x for both files, but write the\n"
+   "    differences as a compact binary delta instead. It describes how to\n"
+   "    turn <old_file> into the input. Both files are read into memory.\n"
+   "    Use -x for reviewing binary differences, and -d for storing or\n"
+   "    transferring them cheaply.\n"
+   "\n"
+   "-D <old_file>: Apply a delta produced by -d, which is read from the\n"
+   "    input, to <old_file> and output the result. This streams through\n"
+   "    <old_file> once, and fails if the delta has been created for a\n"
+   "    different <old_file>.\n"
+   "\n"
+   ,
+   "-k <directory>[:<entries>]: Cache conversion results in the specified\n"
+   "    directory, which must already exist and can be shared by any number\n"
+   "    of concurrently running instances of $APPLICATION_NAME. If the same\n"
+   "    input has already been converted with the same options and LC_CTYPE\n"
+   "    locale before, the cached result will be output instead of\n"
+   "    converting the input again. The cache holds at most <entries>\n"
+   "    results (default: " STRINGIFY(CONFIG_CACHE_ENTRIES) "). The least"
+   " recently used one will be\n"
+   "    replaced when a new result does not fit in any more. All users of\n"
+   "    the same cache directory should specify the same <entries>.\n"
+   "\n"
+   "-u <milliseconds>: Stream the output with low latency. This is meant\n"
+   "    for live input such as a growing log file or a serial capture. All\n"
+   "    output which has been produced so far will be written out whenever\n"
+   #if CONFIG_POSIX
+   "    waiting for more input becomes necessary, and at least every\n"
+   "    <milliseconds> while the input keeps flowing. This option has no\n"
+   "    effect on -X and -B.\n"
+   #else
+   "    an output line has been completed. (This version of\n"
+   "    $APPLICATION_NAME has been built without POSIX support, which would\n"
+   "    be required for honoring <milliseconds>.) This option has no effect\n"
+   "    on -X and -B.\n"
+   #endif
+   "\n"
+   "-o <offset>: Only process the input data starting at the specified\n"
+   "    byte offset. This is fast for seekable input files, because the\n"
+   "    data before <offset> does not need to be read. The output of -x\n"
+   "    and -b stays aligned to the absolute offset within the input: The\n"
+   "    first output line starts with blanks in place of the values before\n"
+   "    <offset> which would otherwise have been displayed in that line.\n"
+   "    With -X and -B, the output is written starting at <offset>\n"
+   "    instead. If the output is redirected like '1<> file' rather than\n"
+   "    '> file', this patches the decoded bytes into the existing file.\n"
+   "\n"
+   "-l <length>: Only process at most <length> bytes of the input data.\n"
+   "    With -X and -B, fail if more than <length> bytes would be written\n"
+   "    instead.\n"
+   "\n"
+   "-F: Process a sequence of framed requests read from the input stream,\n"
+   "    each of which will be treated like a separate invocation of\n"
+   "    $APPLICATION_NAME. This avoids the process startup costs when\n"
+   "    converting many small files. Every request starts with a line\n"
+   "    containing <nargs> and <nbytes> as decimal numbers, followed by\n"
+   "    <nargs> lines with one command line argument each, followed by\n"
+   "    <nbytes> bytes to be used as the input data. Each request is\n"
+   "    answered by a line containing <status> and <nbytes>, followed by\n"
+   "    <nbytes> bytes of output data. <status> is 0 for success or 1 for\n"
+   "    failure, in which case the output data is the error message.\n"
+   "    Other options given together with -F do not apply to the requests;\n"
+   "    every request needs to specify its own options.\n"
+   "\n"
    "-h: Display this help.\n"
    "\n"
    "-V: Display only the copyright and version information.\n"
@@ -136,6 +259,8 @@ static char const *const help[]= {
 #include <errno.h>
 #include <assert.h>
 #include <limits.h>
+#include <setjmp.h>
+#include <time.h>
 
 #ifdef MALLOC_TRACE
    #ifdef NDEBUG
@@ -150,6 +275,11 @@ static char const *const help[]= {
    #include <locale.h>
 #endif
 
+#if CONFIG_POSIX
+   #include <unistd.h>
+   #include <poll.h>
+#endif
+
 #if __STDC_VERSION__ >= 199901 && !CONFIG_NO_LOCALE
    #include <wctype.h>
 #else
@@ -164,6 +294,17 @@ static char const *const help[]= {
 
 #define DIM(array) (sizeof (array) / sizeof *(array))
 
+/* Positions within seekable files. */
+#if CONFIG_POSIX
+   typedef off_t file_pos;
+   #define file_seek fseeko
+   #define file_tell ftello
+#else
+   typedef long file_pos;
+   #define file_seek fseek
+   #define file_tell ftell
+#endif
+
 #define NL_RPLC ' '
 #define ASCII_DUMP_SEP '|'
 #define DUMP_UNIT_SEP ' '
@@ -173,37 +314,46 @@ static char const *const help[]= {
 
 static unsigned long read_pos;
 
+/* The streams all conversions read from, write to and report errors to.
+ * These are the standard streams, except while processing a request in
+ * mode -F. */
+static FILE *in_fp, *out_fp, *err_fp;
+
+/* Where die() returns to instead of terminating the program, if not null. */
+static jmp_buf *die_jmp;
+
 static void die(char const *msg, ...) {
    va_list args;
    va_start(args, msg);
-   (void)vfprintf(stderr, msg, args);
+   (void)vfprintf(err_fp, msg, args);
    va_end(args);
-   (void)fputc('\n', stderr);
+   (void)fputc('\n', err_fp);
    if (read_pos) {
-      (void)fprintf(stderr, "Last read position was %lu.\n", read_pos);
+      (void)fprintf(err_fp, "Last read position was %lu.\n", read_pos);
    }
+   if (die_jmp) longjmp(*die_jmp, 1);
    exit(EXIT_FAILURE);
 }
 
-static void ck_stdin(void) {
-   if (ferror(stdin)) die("Error reading from standard input stream!");
+static void ck_input(void) {
+   if (ferror(in_fp)) die("Error reading from input stream!");
 }
 
-static void stdout_error(void) {
-   die("Error writing to standard output stream!");
+static void output_error(void) {
+   die("Error writing to output stream!");
 }
 
 static void ck_printf(char const *format, ...) {
    va_list args;
    va_start(args, format);
-   if (vprintf(format, args) < 0) stdout_error();
+   if (vfprintf(out_fp, format, args) < 0) output_error();
    va_end(args);
 }
 
 static int ck_getc(void) {
    int r;
-   if ((r= getchar()) == EOF) {
-      ck_stdin();
+   if ((r= getc(in_fp)) == EOF) {
+      ck_input();
    } else {
       assert(r >= 0);
       ++read_pos;
@@ -212,15 +362,15 @@ static int ck_getc(void) {
 }
 
 static void ck_putc(int c) {
-   if (putchar(c) != c) stdout_error();
+   if (putc(c, out_fp) != c) output_error();
 }
 
 static void ck_write(char const *buf, size_t bytes) {
-   if (fwrite(buf, sizeof(char), bytes, stdout) != bytes) stdout_error();
+   if (fwrite(buf, sizeof(char), bytes, out_fp) != bytes) output_error();
 }
 
 static void ck_puts(char const *s) {
-   if (fputs(s, stdout) < 0) stdout_error();
+   if (fputs(s, out_fp) < 0) output_error();
 }
 
 /* Errors which should never happen under normal circumstances. */
@@ -229,10 +379,327 @@ static void internal_error(void) {
 }
 
 static void ck_ungetc(int c) {
-   if (ungetc(c, stdin) != c) internal_error();
+   if (ungetc(c, in_fp) != c) internal_error();
    --read_pos;
 }
 
+/* Block-oriented input buffer used by all modes except -X and -B. Reading
+ * through it rather than with ck_getc() allows the text modes to inspect and
+ * copy whole runs of characters at once. It must not be mixed with the
+ * stdio-level input functions for the same input stream. */
+static char in_buf[BUFSIZ];
+static size_t in_pos, in_len;
+
+/* The output latency budget in milliseconds set by option -u, or -1. */
+static long latency_ms= -1;
+
+/* The byte range selected by options -o and -l. If <range_limited>,
+ * <range_left> is the number of bytes which may still be read (or written
+ * by -X and -B). */
+static unsigned long range_offset, range_left;
+static int range_limited;
+
+/* Returns how many bytes may be read into a buffer of <size> bytes without
+ * exceeding the range limit. */
+static size_t range_avail(size_t size) {
+   return range_limited && range_left < size ? (size_t)range_left : size;
+}
+
+/* Accounts for <bytes> bytes having been read. */
+static void range_consume(size_t bytes) {
+   if (range_limited) {
+      assert(bytes <= range_left);
+      range_left-= (unsigned long)bytes;
+   }
+}
+
+#if CONFIG_POSIX
+   static struct timespec last_flush;
+
+   static void stream_flush(void) {
+      if (fflush(out_fp)) output_error();
+      (void)clock_gettime(CLOCK_MONOTONIC, &last_flush);
+   }
+
+   /* Refills <in_buf> in mode -u with whatever input is available, rather
+    * than waiting for a whole buffer. The output is flushed before reading
+    * would block, or if the latency budget has been exceeded since it has
+    * last been flushed. */
+   static size_t stream_read(void) {
+      int const fd= fileno(in_fp);
+      ssize_t n;
+      {
+         struct pollfd pfd;
+         struct timespec now;
+         pfd.fd= fd; pfd.events= POLLIN;
+         if (
+               poll(&pfd, 1, 0) != 1
+            || clock_gettime(CLOCK_MONOTONIC, &now)
+            || (now.tv_sec - last_flush.tv_sec) * 1000L
+               + (now.tv_nsec - last_flush.tv_nsec) / 1000000L >= latency_ms
+         ) {
+            stream_flush();
+         }
+      }
+      while ((n= read(fd, in_buf, range_avail(sizeof in_buf))) < 0) {
+         if (errno != EINTR) die("Error reading from input stream!");
+      }
+      return (size_t)n;
+   }
+#endif
+
+/* Returns the number of buffered but not yet consumed input bytes at
+ * <in_buf + in_pos>, refilling the buffer first if it has run empty. Returns
+ * 0 only at EOF. */
+static size_t in_avail(void) {
+   if (in_pos == in_len) {
+      in_pos= 0;
+      if (latency_ms >= 0) {
+         #if CONFIG_POSIX
+            in_len= stream_read();
+         #else
+            /* Do not wait for more input than what is needed next. The
+             * output has been made line buffered instead. */
+            int c;
+            if (!range_avail(1) || (c= getc(in_fp)) == EOF) {
+               ck_input();
+               in_len= 0;
+            } else {
+               in_buf[0]= (char)c;
+               in_len= 1;
+            }
+         #endif
+      } else if (
+         !(
+            in_len= fread(
+               in_buf, sizeof(char), range_avail(sizeof in_buf), in_fp
+            )
+         )
+      ) {
+         ck_input();
+      }
+      range_consume(in_len);
+   }
+   assert(in_pos <= in_len);
+   return in_len - in_pos;
+}
+
+/* Mark <bytes> bytes of the buffered input as consumed. */
+static void in_skip(size_t bytes) {
+   assert(bytes <= in_len - in_pos);
+   in_pos+= bytes;
+   read_pos+= (unsigned long)bytes;
+}
+
+/* Returns the last <bytes> consumed bytes to the buffered input. They must
+ * all have been consumed since the buffer has last been refilled. */
+static void in_unskip(size_t bytes) {
+   assert(bytes <= in_pos);
+   in_pos-= bytes;
+   read_pos-= (unsigned long)bytes;
+}
+
+/* Like ck_getc(), but reads from <in_buf>. */
+static int ck_bgetc(void) {
+   int r;
+   if (!in_avail()) return EOF;
+   r= (unsigned char)in_buf[in_pos];
+   in_skip(1);
+   return r;
+}
+
+/* Positions <fp> at <offset> bytes from the start of the file. Returns
+ * nonzero if this fails, including when <offset> is not representable as a
+ * <file_pos>. */
+static int seek_offset(FILE *fp, unsigned long offset) {
+   file_pos const pos= (file_pos)offset;
+   if (pos < 0 || (unsigned long)pos != offset) return -1;
+   return file_seek(fp, pos, SEEK_SET);
+}
+
+/* Positions the input stream at <range_offset>. */
+static void range_seek_input(void) {
+   if (seek_offset(in_fp, range_offset)) {
+      /* Not seekable. Skip the bytes before the range by reading them
+       * through <in_buf> like all the remaining input, because mode -u
+       * would not see data buffered by the stdio-level functions. */
+      unsigned long left= range_offset;
+      unsigned long const pos= read_pos;
+      int const limited= range_limited;
+      size_t n;
+      range_limited= 0;
+      while (left && (n= in_avail())) {
+         if (n > left) n= (size_t)left;
+         in_skip(n);
+         left-= (unsigned long)n;
+      }
+      read_pos= pos;
+      if (range_limited= limited) {
+         /* Account for the data after <range_offset> which has already been
+          * buffered. */
+         if ((n= in_len - in_pos) > range_left) {
+            in_len= in_pos + (n= (size_t)range_left);
+         }
+         range_consume(n);
+      }
+   }
+}
+
+/* The record layout selected by option -r: Records of <record_size> bytes
+ * (0 if no records have been selected), of which only the bytes within
+ * <fields> are processed. Every field is a range of offsets within the
+ * record (first and last), and the fields are in ascending order. Only the
+ * fields from <fld_first> up to but excluding <fld_last> are currently in
+ * effect. <rec_pos> is the current offset within a record and <fld> the
+ * first field in effect which does not end before it. */
+static unsigned long record_size, rec_pos;
+static unsigned long (*fields)[2];
+static unsigned nfields, fld_first, fld_last, fld;
+
+/* Parses the argument <spec> of option -r. Returns 0 if it is invalid. */
+static int parse_fields(char const *spec) {
+   char *end;
+   unsigned n;
+   if (
+         !strchr("0123456789", *spec) || !*spec
+      || !(record_size= strtoul(spec, &end, 0))
+      || record_size > ULONG_MAX / 2
+   ) {
+      return 0;
+   }
+   for (n= 1, spec= end; *spec; ) if (*spec++ == ',') ++n;
+   if (!(fields= malloc(n * sizeof *fields))) die("Memory allocation error!");
+   if (!*end) {
+      /* All bytes of the record. */
+      fields[0][0]= 0; fields[0][1]= record_size - 1;
+      nfields= 1;
+      return 1;
+   }
+   if (*end != ':') return 0;
+   for (nfields= 0; nfields < n; ++nfields) {
+      unsigned long *const f= fields[nfields];
+      spec= end + 1;
+      if (!strchr("0123456789", *spec) || !*spec) return 0;
+      f[0]= f[1]= strtoul(spec, &end, 0);
+      if (*end == '-') {
+         spec= end + 1;
+         if (!strchr("0123456789", *spec) || !*spec) return 0;
+         f[1]= strtoul(spec, &end, 0);
+      }
+      if (
+            *end != (nfields + 1 < n ? ',' : '\0')
+         || f[0] > f[1] || f[1] >= record_size
+         || nfields && f[0] <= fields[nfields - 1][1]
+      ) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/* Positions the record layout at absolute offset <offset>, with the fields
+ * from <fld_first> to <fld_last> in effect. */
+static void fields_seek(unsigned long offset) {
+   rec_pos= offset % record_size;
+   for (fld= fld_first; fld < fld_last && fields[fld][1] < rec_pos; ) ++fld;
+}
+
+/* Returns the number of bytes within the fields in effect which a record
+ * has before offset <pos> from its start. */
+static unsigned long fields_before(unsigned long pos) {
+   unsigned long n= 0;
+   unsigned i;
+   for (i= fld_first; i < fld_last && fields[i][0] < pos; ++i) {
+      n+= (fields[i][1] < pos ? fields[i][1] + 1 : pos) - fields[i][0];
+   }
+   return n;
+}
+
+/* Returns the number of unselected bytes before the next selected one, and
+ * advances the current position beyond them. */
+static unsigned long fields_gap(void) {
+   unsigned long gap;
+   if (fld < fld_last) {
+      if (fields[fld][0] <= rec_pos) return 0;
+      gap= fields[fld][0] - rec_pos;
+   } else {
+      /* Continue with the first field of the next record. */
+      gap= record_size - rec_pos + fields[fld= fld_first][0];
+   }
+   rec_pos= fields[fld][0];
+   return gap;
+}
+
+/* Advances the current position beyond a selected byte. */
+static void fields_step(void) {
+   assert(fld < fld_last && fields[fld][0] <= rec_pos);
+   if (rec_pos++ == fields[fld][1]) ++fld;
+   if (rec_pos == record_size) { rec_pos= 0; fld= fld_first; }
+}
+
+/* Like ck_bgetc(), but only returns the selected bytes if option -r is in
+ * effect. */
+static int field_bgetc(void) {
+   if (record_size) {
+      unsigned long gap= fields_gap();
+      while (gap) {
+         size_t n;
+         if (!(n= in_avail())) return EOF;
+         if (n > gap) n= (size_t)gap;
+         in_skip(n);
+         gap-= (unsigned long)n;
+      }
+      fields_step();
+   }
+   return ck_bgetc();
+}
+
+/* Outputs a byte decoded by -X or -B. For those modes, option -l limits the
+ * number of bytes written rather than read. */
+static int decode_limited;
+static unsigned long decode_left;
+
+/* The records file of option -m, if any. The decoded bytes replace its
+ * selected bytes, and its other bytes are copied to the output. */
+static char const *merge_name;
+static FILE *merge_fp;
+
+/* Copies the bytes of <merge_fp> before the next selected byte to the output
+ * and skips the selected byte. Returns 0 if there is no such byte. */
+static int merge_advance(void) {
+   unsigned long gap= fields_gap();
+   char buf[BUFSIZ];
+   for (;;) {
+      size_t n= gap < sizeof buf ? (size_t)gap : sizeof buf;
+      if (decode_limited && n > decode_left) n= (size_t)decode_left;
+      if (!gap) n= 1; /* The selected byte itself. */
+      if (
+            decode_limited && decode_left < n
+         || !(n= fread(buf, sizeof(char), n, merge_fp))
+      ) {
+         if (ferror(merge_fp)) die("Error reading file \"%s\"!", merge_name);
+         return 0;
+      }
+      if (decode_limited) decode_left-= (unsigned long)n;
+      if (!gap) break;
+      ck_write(buf, n);
+      gap-= (unsigned long)n;
+   }
+   fields_step();
+   return 1;
+}
+
+static void put_decoded(int byte) {
+   if (merge_fp) {
+      if (!merge_advance()) {
+         die("More data has been decoded than there are selected bytes!");
+      }
+   } else if (decode_limited && !decode_left--) {
+      die("More data has been decoded than allowed by option -l!");
+   }
+   if (putc(byte, out_fp) == EOF) output_error();
+}
+
 #if CONFIG_NO_LOCALE
    #ifdef wctomb
       #undef wctomb
@@ -265,6 +732,100 @@ static void ck_ungetc(int c) {
    }
 #endif
 
+/* In -c and -w encodings, the following whitespace characters are
+ * transformed into a sequence of 1 to 6 consecutive SPACE characters,
+ * terminated by HT. The length of the sequence corresponds to the 1-based
+ * character position in the string below. As a special abbreviation rule,
+ * SPACE and HT in the transformed output which do not match the above
+ * pattern represent themselves literally. */
+static char const wse[]= {"\012\040\015\011\014\013"};
+
+/* Character classes as seen by the state machines of the text modes. All
+ * whitespace classes are >= cc_otherws, and the class of wse[i] is
+ * cc_wse + i. */
+enum { cc_word, cc_term, cc_invalid, cc_otherws, cc_wse };
+
+static int classify(wchar_t wc) {
+   if (wc == (wchar_t)WS_OPT_TERMINATOR) return cc_term;
+   if (!iswspace(wc)) return cc_word;
+   if (wc < (wchar_t)128 /* ASCII? */) {
+      char const *found;
+      if (found= strchr(wse, (char)(unsigned char)wc)) {
+         return cc_wse + (int)(found - wse);
+      }
+   }
+   return cc_otherws;
+}
+
+/* The classes of all bytes which are a complete character on their own,
+ * indexed by their (unsigned) byte value. All other bytes are cc_invalid;
+ * with a multibyte character set, this includes the bytes which start a
+ * longer character. */
+#define STATIC_CHAR_CLASS (CONFIG_NO_LOCALE && UCHAR_MAX == 255)
+#if STATIC_CHAR_CLASS
+   /* Without locale support, this does not depend on anything which is only
+    * known at runtime. */
+   #define W_ cc_word
+   #define W8_ W_, W_, W_, W_, W_, W_, W_, W_
+   #define W16_ W8_, W8_
+   #define W64_ W16_, W16_, W16_, W16_
+   static char const char_class[UCHAR_MAX + 1]= {
+      /* 0x00 */ W8_, W_, cc_wse + 3, cc_wse + 0, cc_wse + 5
+                    , cc_wse + 4, cc_wse + 2, W_, W_
+      /* 0x10 */ , W16_
+      /* 0x20 */ , cc_wse + 1, W_, W_, W_, cc_term, W_, W_, W_, W8_
+      /* 0x30 */ , W16_, W64_, W64_, W64_
+   };
+   #undef W64_
+   #undef W16_
+   #undef W8_
+   #undef W_
+#else
+   static char char_class[UCHAR_MAX + 1];
+#endif
+
+#if STATIC_CHAR_CLASS && defined NDEBUG
+   #define init_char_class() ((void)0)
+#else
+   /* Fills <char_class> for the current locale. With STATIC_CHAR_CLASS, it
+    * just verifies its contents, which is only done in debug builds. */
+   static void init_char_class(void) {
+      unsigned i;
+      for (i= 0; i <= UCHAR_MAX; ++i) {
+         char byte= (char)i;
+         auto wchar_t wc; /* Address will be taken. */
+         int const cls=
+            mbtowc(&wc, &byte, 1) == -1 ? cc_invalid : classify(wc)
+         ;
+         #if STATIC_CHAR_CLASS
+            assert(char_class[i] == cls);
+         #else
+            char_class[i]= (char)cls;
+         #endif
+      }
+      (void)mbtowc(0, 0, 0);
+   }
+#endif
+
+/* Determines the class <*cls> of the character starting at <p>, where <n>
+ * bytes are available, and returns its length in bytes. Returns 0 if there
+ * is no complete valid character, which is then left to the state machines
+ * of the text modes. This must only be used with a character set which
+ * has no shift states. */
+static size_t char_at(char const *p, size_t n, int *cls) {
+   int r;
+   auto wchar_t wc; /* Address will be taken. */
+   if ((*cls= char_class[(unsigned char)*p]) != cc_invalid) return 1;
+   if (MB_CUR_MAX == 1) return 0;
+   if ((r= mbtowc(&wc, p, n)) <= 0) {
+      /* An incomplete character may have left a conversion state behind. */
+      (void)mbtowc(0, 0, 0);
+      return 0;
+   }
+   *cls= classify(wc);
+   return (size_t)r;
+}
+
 static void appinfo(const char *text, const char *app) {
    static char const marker[]= "$APPLICATION_NAME";
    int const mlen= (int)(sizeof marker - sizeof(char));
@@ -277,10 +838,148 @@ static void appinfo(const char *text, const char *app) {
    if (text) ck_puts(text);
 }
 
-static char *dump_buf= 0;
+/* Conversion result cache (option -k). Entries are files named after their
+ * set and way numbers. Each one starts with a header line containing a
+ * fixed-width "last used" time stamp followed by <cache_magic>, the hash and
+ * size of the input data and the conversion options, and the converted
+ * output follows after that. The hash also covers <version_info>, so that
+ * results of other versions of the program will never be used. New entries
+ * are written to a uniquely named temporary file and then renamed, so
+ * readers will only ever see complete entries. */
+static char const cache_magic[]= "DPk1";
+static char const *cache_dir;
+static unsigned long cache_entries;
+static FILE *cache_fp; /* New entry being written. */
+static FILE *cache_out; /* Actual output stream while writing <cache_fp>. */
+static long cache_hdr_len;
+static char cache_tmp[FILENAME_MAX], cache_victim[FILENAME_MAX];
+/* Resources used while looking up an entry. They are kept here rather than
+ * in local variables, so that cleanup() can release them after a failure. */
+static char *cache_key, *cache_tail, *cache_line;
+static FILE *cache_entry; /* Existing entry being examined. */
+static FILE *cache_spool; /* Copy of unseekable input being made. */
+
+static void cache_release(void) {
+   if (cache_entry) {
+      (void)fclose(cache_entry); cache_entry= 0;
+   }
+   if (cache_spool) {
+      (void)fclose(cache_spool); cache_spool= 0;
+   }
+   free(cache_key); free(cache_tail); free(cache_line);
+   cache_key= cache_tail= cache_line= 0;
+}
+
+/* Binary deltas (options -d and -D). <delta_base> is the name of the old
+ * file, <base_fp> is the stream reading it while a delta is being applied.
+ * The other variables are only used while a delta is being created. */
+static char const *delta_base;
+static FILE *base_fp;
+static char *old_data, *new_data;
+static size_t *block_head, *block_next;
+
+/* The ASCII dump of the current output line of option -a, already mapped
+ * to the characters to be displayed. Only its first characters are kept in
+ * <dump_buf>. The remaining ones of very long lines are spilled into the
+ * temporary file <dump_spill>, so that the memory usage does not depend on
+ * option -n. <dump_last> is the latest character added. */
+static char dump_buf[BUFSIZ], dump_last;
+static unsigned long dump_len;
+static FILE *dump_spill;
+
+static void dump_put(int c) {
+   dump_last= (char)(c= c >= 0x20 && c < 0x7f ? c : '.');
+   if (dump_len < sizeof dump_buf) {
+      dump_buf[dump_len]= dump_last;
+   } else {
+      if (dump_len == sizeof dump_buf) {
+         if (!dump_spill && !(dump_spill= tmpfile())) {
+            die("Could not create temporary file!");
+         }
+         rewind(dump_spill);
+      }
+      if (putc(c, dump_spill) == EOF) die("Error writing to temporary file!");
+   }
+   ++dump_len;
+}
+
+/* Outputs the ASCII dump except for the latest character if <keep>, which
+ * then remains as the only one. */
+static void dump_flush(int keep) {
+   unsigned long n= dump_len - (unsigned long)keep;
+   if (!n) return;
+   ck_putc(ASCII_DUMP_SEP);
+   if (n <= sizeof dump_buf) {
+      ck_write(dump_buf, (size_t)n);
+   } else {
+      ck_write(dump_buf, sizeof dump_buf);
+      n-= sizeof dump_buf;
+      rewind(dump_spill);
+      while (n) {
+         char buf[BUFSIZ];
+         size_t const chunk= n < sizeof buf ? (size_t)n : sizeof buf;
+         if (fread(buf, sizeof(char), chunk, dump_spill) != chunk) {
+            die("Error reading temporary file!");
+         }
+         ck_write(buf, chunk);
+         n-= (unsigned long)chunk;
+      }
+   }
+   if (keep) dump_buf[0]= dump_last;
+   dump_len= (unsigned long)keep;
+}
+
+/* Option -p: The file name prefix for the separate field dumps, the stream
+ * writing the current one and the actual output stream meanwhile. */
+static char const *split_prefix;
+static FILE *split_fp, *split_out;
+static file_pos split_start; /* Where the input starts. */
+static unsigned long split_left; /* <range_left> at that point. */
 
 static void cleanup() {
-   if (dump_buf) free(dump_buf);
+   if (dump_spill) {
+      (void)fclose(dump_spill);
+      dump_spill= 0;
+   }
+   if (cache_fp) {
+      /* Conversion failed. Discard the incomplete cache entry. */
+      (void)fclose(cache_fp); cache_fp= 0;
+      (void)remove(cache_tmp);
+      out_fp= cache_out; cache_out= 0;
+   }
+   cache_release();
+   cache_dir= 0; cache_entries= 0;
+   if (base_fp) {
+      (void)fclose(base_fp); base_fp= 0;
+   }
+   free(old_data); free(new_data); old_data= new_data= 0;
+   free(block_head); free(block_next); block_head= block_next= 0;
+   delta_base= 0;
+   if (merge_fp) {
+      (void)fclose(merge_fp); merge_fp= 0;
+   }
+   merge_name= 0;
+   if (split_fp) {
+      (void)fclose(split_fp); split_fp= 0;
+      out_fp= split_out; split_out= 0;
+   }
+   split_prefix= 0;
+   free(fields); fields= 0;
+   record_size= 0; nfields= 0;
+   latency_ms= -1;
+   range_offset= 0; range_limited= decode_limited= 0;
+}
+
+/* Returns <a> * <b> % <m> without the risk of an overflow. */
+static unsigned long mulmod(
+   unsigned long a, unsigned long b, unsigned long m
+) {
+   unsigned long r= 0;
+   for (a%= m; b; b>>= 1) {
+      if (b & 1) r= r >= m - a ? r - (m - a) : r + a;
+      a= a >= m - a ? a - (m - a) : a + a;
+   }
+   return r;
 }
 
 static int ignore_line_suffix(void) {
@@ -296,10 +995,697 @@ static int ignore_line_suffix(void) {
    return 1;
 }
 
+/* Copies exactly <bytes> bytes of frame data from <from> to <to>. */
+static void copy_frame_data(FILE *from, FILE *to, unsigned long bytes) {
+   char buf[BUFSIZ];
+   while (bytes) {
+      size_t const n= bytes < sizeof buf ? (size_t)bytes : sizeof buf;
+      if (fread(buf, sizeof(char), n, from) != n) {
+         die(
+               ferror(from)
+            ?  "Error reading frame data!"
+            :  "Unexpected end of frame data!"
+         );
+      }
+      if (fwrite(buf, sizeof(char), n, to) != n) {
+         die("Error writing frame data!");
+      }
+      bytes-= (unsigned long)n;
+   }
+}
+
+/* Updates the 64 bit FNV-1a hash <h> with <bytes> bytes from <buf>. As
+ * ANSI C89 has no integer type guaranteed to be that wide, <h> is represented
+ * as its upper and lower 32 bit halves. */
+static void fnv1a64(unsigned long h[2], char const *buf, size_t bytes) {
+   unsigned long hi= h[0], lo= h[1];
+   while (bytes--) {
+      unsigned long m0, m1, mid;
+      lo^= (unsigned char)*buf++;
+      /* Multiply by the FNV prime 2 ** 40 + 0x1b3. The partial products of
+       * the lower half are formed from 16-bit pieces so that no
+       * intermediate result can exceed 32 bits. */
+      m0= (lo & 0xffff) * 0x1b3;
+      m1= (lo >> 16) * 0x1b3;
+      mid= (m1 & 0xffff) + (m0 >> 16);
+      hi= hi * 0x1b3 + (m1 >> 16) + (mid >> 16) + (lo << 8) & 0xffffffff;
+      lo= (mid & 0xffff) << 16 | m0 & 0xffff;
+   }
+   h[0]= hi; h[1]= lo;
+}
+
+/* Copies the remaining contents of <from> to <out_fp>. */
+static void copy_rest(FILE *from) {
+   char buf[BUFSIZ];
+   size_t n;
+   while (n= fread(buf, sizeof(char), sizeof buf, from)) ck_write(buf, n);
+   if (ferror(from)) die("Error reading cache entry!");
+}
+
+/* Looks up the conversion result of the input stream for the conversion
+ * options described by <key>. Returns nonzero if it has been found and has
+ * already been written to the output stream. Otherwise, the output stream
+ * may have been redirected into a new cache entry, which cache_store() will
+ * publish after the conversion. Either way, the input stream will have been
+ * rewound. */
+static int cache_lookup(char const *key) {
+   unsigned long h[2], size= 0, set;
+   unsigned long const now= (unsigned long)time(0);
+   unsigned way, victim= 0;
+   unsigned const ways=
+         cache_entries < CONFIG_CACHE_WAYS ? (unsigned)cache_entries
+      :  CONFIG_CACHE_WAYS
+   ;
+   unsigned long oldest= ULONG_MAX;
+   char *tail, *line;
+   size_t tail_len;
+   FILE *f;
+   h[0]= 0xcbf29ce4; h[1]= 0x84222325;
+   fnv1a64(h, version_info, sizeof version_info);
+   fnv1a64(h, key, strlen(key) + 1);
+   {
+      char buf[BUFSIZ];
+      size_t n;
+      file_pos start;
+      /* Input after <range_offset> may already have been buffered by
+       * range_seek_input(), which only happens if it is not seekable. */
+      unsigned long const range_size=
+         range_left + (unsigned long)(in_len - in_pos)
+      ;
+      FILE *spool= 0;
+      if ((start= file_tell(in_fp)) < 0 || in_pos != in_len) {
+         /* Not seekable. Keep a copy of the input which can be rewound. */
+         if (!(spool= cache_spool= tmpfile())) {
+            die("Could not create temporary file!");
+         }
+         start= 0;
+         if (n= in_len - in_pos) {
+            fnv1a64(h, in_buf + in_pos, n);
+            size+= (unsigned long)n;
+            if (fwrite(in_buf + in_pos, sizeof(char), n, spool) != n) {
+               die("Error writing to temporary file!");
+            }
+            in_pos= in_len= 0;
+         }
+      }
+      while (n= fread(buf, sizeof(char), range_avail(sizeof buf), in_fp)) {
+         range_consume(n);
+         fnv1a64(h, buf, n);
+         size+= (unsigned long)n;
+         if (spool && fwrite(buf, sizeof(char), n, spool) != n) {
+            die("Error writing to temporary file!");
+         }
+      }
+      ck_input();
+      range_left= range_size;
+      if (spool) {
+         /* The original input stream has been consumed completely. */
+         (void)fclose(in_fp);
+         in_fp= spool; cache_spool= 0;
+      }
+      if (file_seek(in_fp, start, SEEK_SET)) {
+         die("Could not rewind input!");
+      }
+   }
+   set= h[1] % (cache_entries / ways);
+   if (strlen(cache_dir) > sizeof cache_tmp - 128) {
+      die("Cache directory path name is too long!");
+   }
+   if (
+         !(tail= cache_tail= malloc(tail_len= strlen(key) + 64))
+      || !(line= cache_line= malloc(tail_len + 16))
+   ) {
+      die("Memory allocation error!");
+   }
+   (void)sprintf(
+      tail, "%s %08lX%08lX %lu %s\n", cache_magic, h[0], h[1], size, key
+   );
+   tail_len= strlen(tail);
+   for (way= 0; way < ways; ++way) {
+      int writable= 1;
+      unsigned long stamp;
+      (void)sprintf(cache_victim, "%s/%02lX-%u", cache_dir, set, way);
+      if (!(f= cache_entry= fopen(cache_victim, "r+b"))) {
+         writable= 0;
+         if (!(f= cache_entry= fopen(cache_victim, "rb"))) {
+            /* Unused way. Prefer it over any used one. */
+            if (oldest) { oldest= 0; victim= way; }
+            continue;
+         }
+      }
+      if (!fgets(line, (int)(tail_len + 16), f)) {
+         line[0]= '\0';
+      } else if (
+         strlen(line) == 11 + tail_len && line[10] == ' '
+         && !strcmp(line + 11, tail)
+      ) {
+         /* Cache hit. Mark the entry as recently used and output it. */
+         if (
+               writable && !fseek(f, 0, SEEK_SET)
+            && fprintf(f, "%010lu", now) == 10
+         ) {
+            (void)fflush(f);
+         }
+         if (fseek(f, (long)(11 + tail_len), SEEK_SET)) {
+            die("Error reading cache entry!");
+         }
+         copy_rest(f);
+         (void)fclose(f); cache_entry= 0;
+         free(line); free(tail); cache_line= cache_tail= 0;
+         return 1;
+      }
+      stamp= strtoul(line, 0, 10);
+      if (stamp < oldest) { oldest= stamp; victim= way; }
+      (void)fclose(f); cache_entry= 0;
+   }
+   /* Cache miss. Start writing a new entry which will replace the least
+    * recently used one in the set. Without a writable cache directory, just
+    * do the conversion without caching. */
+   (void)sprintf(cache_victim, "%s/%02lX-%u", cache_dir, set, victim);
+   #if CONFIG_POSIX
+      /* No other running process can have the same ID. */
+      (void)sprintf(
+            cache_tmp, "%s/%08lX%08lX.%lX.tmp", cache_dir, h[0], h[1]
+         ,  (unsigned long)getpid()
+      );
+      cache_fp= fopen(cache_tmp, "w+b");
+   #else
+      {
+         /* Try a few names until one is found which is not in use. Without
+          * the exclusive mode of C11, a name can only be checked before it
+          * is opened. */
+         unsigned long seq= now ^ (unsigned long)clock();
+         unsigned tries;
+         for (tries= 0; tries < 16; ++tries) {
+            (void)sprintf(
+                  cache_tmp, "%s/%08lX%08lX.%lX.tmp", cache_dir, h[0], h[1]
+               ,  seq++ & 0xffffffff
+            );
+            #if __STDC_VERSION__ >= 201112L
+               if (cache_fp= fopen(cache_tmp, "w+bx")) break;
+            #else
+               if (f= fopen(cache_tmp, "rb")) {
+                  (void)fclose(f);
+                  continue;
+               }
+               cache_fp= fopen(cache_tmp, "w+b");
+               break;
+            #endif
+         }
+      }
+   #endif
+   if (cache_fp) {
+      if (
+            fprintf(cache_fp, "%010lu %s", now, tail) < 0
+         || (cache_hdr_len= ftell(cache_fp)) < 0
+      ) {
+         die("Error writing cache entry!");
+      }
+      cache_out= out_fp; out_fp= cache_fp;
+   }
+   free(line); free(tail); cache_line= cache_tail= 0;
+   return 0;
+}
+
+/* Outputs the new cache entry started by cache_lookup() and publishes it. */
+static void cache_store(void) {
+   long size;
+   assert(cache_fp && out_fp == cache_fp);
+   out_fp= cache_out; cache_out= 0;
+   if (fflush(cache_fp) || (size= ftell(cache_fp)) < 0) {
+      die("Error writing cache entry!");
+   }
+   if (fseek(cache_fp, cache_hdr_len, SEEK_SET)) {
+      die("Error reading cache entry!");
+   }
+   copy_rest(cache_fp);
+   (void)fclose(cache_fp); cache_fp= 0;
+   if (
+         size - cache_hdr_len > CONFIG_CACHE_MAX_ENTRY
+      || rename(cache_tmp, cache_victim)
+         /* Not all platforms allow rename() to replace existing files. */
+         && (remove(cache_victim), rename(cache_tmp, cache_victim))
+   ) {
+      (void)remove(cache_tmp);
+   }
+   cache_tmp[0]= '\0';
+}
+
+/* Reads all remaining data of <fp> into a new buffer and stores its size in
+ * <size>. When reading the input stream, the range selected by -o and -l is
+ * honored. */
+static char *read_all(FILE *fp, size_t *size) {
+   char *buf= 0;
+   size_t len= 0, cap= 0;
+   for (;;) {
+      size_t n;
+      if (len == cap) {
+         char *const grown=
+               cap <= ((size_t)-1 - BUFSIZ) / 2
+            ?  realloc(buf, cap * 2 + BUFSIZ)
+            :  0
+         ;
+         if (!grown) {
+            free(buf);
+            die("Memory allocation error!");
+         }
+         buf= grown; cap= cap * 2 + BUFSIZ;
+      }
+      if (fp == in_fp) {
+         if (!(n= in_avail())) break;
+         if (n > cap - len) n= cap - len;
+         (void)memcpy(buf + len, in_buf + in_pos, n);
+         in_skip(n);
+      } else if (!(n= fread(buf + len, sizeof(char), cap - len, fp))) {
+         if (ferror(fp)) die("Error reading file \"%s\"!", delta_base);
+         break;
+      }
+      len+= n;
+   }
+   *size= len;
+   return buf;
+}
+
+/* A delta created by -d starts with <delta_magic>, followed by the sizes and
+ * FNV-1a hashes of the old and of the new data. Then follows a sequence of
+ * operations which transform the old data into the new data. Every
+ * operation is an opcode byte followed by a length. The operations consume
+ * the old data strictly sequentially, so applying a delta only needs to
+ * stream through the old data once. Sizes and lengths are unsigned LEB128
+ * numbers and hashes are written as 8 bytes in big-endian byte order. */
+static char const delta_magic[]= "DPd1";
+
+enum {
+   op_end, /* End of the delta. Has no length. */
+   op_copy, /* Output the next <length> bytes of old data. */
+   op_insert, /* Output the <length> bytes following in the delta. */
+   op_replace, /* Like op_delete followed by op_insert. */
+   op_delete /* Skip the next <length> bytes of old data. */
+};
+
+/* Parameters of the matching heuristics used by -d: The old data is indexed
+ * in blocks of DELTA_BLOCK bytes, at most DELTA_CANDIDATES indexed blocks
+ * are compared when looking for a match, and matches which keep the old and
+ * new data in step (as it happens when bytes have been replaced by the same
+ * number of different bytes) need to be at least DELTA_STEP_MIN bytes
+ * long. */
+#define DELTA_BLOCK 16
+#define DELTA_CANDIDATES 16
+#define DELTA_STEP_MIN 8
+
+static void put_varint(unsigned long v) {
+   while (v > 0x7f) {
+      ck_putc((int)(v & 0x7f | 0x80));
+      v>>= 7;
+   }
+   ck_putc((int)v);
+}
+
+static int get_delta_byte(void) {
+   int c;
+   if ((c= ck_bgetc()) == EOF) die("Unexpected end of delta!");
+   return c;
+}
+
+static unsigned long get_varint(void) {
+   unsigned long v= 0, bits;
+   unsigned shift= 0;
+   int c;
+   do {
+      bits= (unsigned long)((c= get_delta_byte()) & 0x7f);
+      if (shift >= sizeof v * CHAR_BIT || bits << shift >> shift != bits) {
+         die("Number in delta is too large!");
+      }
+      v|= bits << shift;
+      shift+= 7;
+   } while (c & 0x80);
+   return v;
+}
+
+static void put_hash(unsigned long const h[2]) {
+   int i, shift;
+   for (i= 0; i < 2; ++i) {
+      for (shift= 24; shift >= 0; shift-= 8) {
+         ck_putc((int)(h[i] >> shift & 0xff));
+      }
+   }
+}
+
+static void get_hash(unsigned long h[2]) {
+   int i, j;
+   for (i= 0; i < 2; ++i) {
+      for (h[i]= 0, j= 0; j < 4; ++j) {
+         h[i]= h[i] << 8 | (unsigned long)get_delta_byte();
+      }
+   }
+}
+
+/* Writes the size and hash of <bytes> bytes of data at <buf>. */
+static void put_data_info(char const *buf, size_t bytes) {
+   unsigned long h[2];
+   h[0]= 0xcbf29ce4; h[1]= 0x84222325;
+   fnv1a64(h, buf, bytes);
+   put_varint((unsigned long)bytes);
+   put_hash(h);
+}
+
+/* Length of a copy operation which has not been written yet, because it
+ * might still be extended. */
+static unsigned long delta_copy;
+
+/* Writes an operation for <len> bytes, taking any data from <data>. Copy
+ * operations are accumulated, and operations of length 0 are omitted. */
+static void delta_op(int op, size_t len, char const *data) {
+   if (op == op_copy) {
+      delta_copy+= (unsigned long)len;
+      return;
+   }
+   if (!len && op != op_end) return;
+   if (delta_copy) {
+      ck_putc(op_copy);
+      put_varint(delta_copy);
+      delta_copy= 0;
+   }
+   ck_putc(op);
+   if (op != op_end) {
+      put_varint((unsigned long)len);
+      if (data) ck_write(data, len);
+   }
+}
+
+/* Writes the operations replacing the next <nold> bytes of old data by the
+ * <nnew> bytes at <data>. */
+static void delta_edit(size_t nold, char const *data, size_t nnew) {
+   size_t const n= nold < nnew ? nold : nnew;
+   delta_op(op_replace, n, data);
+   delta_op(op_delete, nold - n, 0);
+   delta_op(op_insert, nnew - n, data + n);
+}
+
+/* A polynomial hash of the DELTA_BLOCK bytes at <p>. */
+static unsigned long block_hash(char const *p) {
+   unsigned long h= 0;
+   int i;
+   for (i= 0; i < DELTA_BLOCK; ++i) {
+      h= h * 257 + (unsigned char)p[i] & 0xffffffff;
+   }
+   return h;
+}
+
+/* Maps block hash <h> to one of 2 ** <bits> hash buckets. */
+static size_t block_bucket(unsigned long h, unsigned bits) {
+   return (size_t)((h * 0x9e3779b1 & 0xffffffff) >> 32 - bits);
+}
+
+/* Returns the length of the common prefix of <a> and <b>, but at most
+ * <max>. */
+static size_t match_len(char const *a, char const *b, size_t max) {
+   size_t n= 0;
+   while (n < max && a[n] == b[n]) ++n;
+   return n;
+}
+
+/* Implements mode -d for the <nold> bytes at <old_data> and the <nnew> bytes
+ * at <new_data>. The new data is scanned for the longest match with the old
+ * data which starts at or after the current old position, considering both
+ * continuing in step and the indexed old blocks. The bytes skipped until
+ * then in both become replace, delete and insert operations, and the match
+ * becomes a copy operation. */
+static void make_delta(size_t nold, size_t nnew) {
+   char const *const od= old_data, *const nd= new_data;
+   size_t i, j, lit, base, suffix, oend, nend, nblocks;
+   unsigned long h= 0, top= 1;
+   unsigned bits= 1;
+   int rehash= 1;
+   ck_write(delta_magic, sizeof delta_magic - sizeof(char));
+   put_data_info(od, nold);
+   put_data_info(nd, nnew);
+   delta_copy= 0;
+   for (j= 0; j < nold && j < nnew && od[j] == nd[j]; ++j) {}
+   for (
+      suffix= 0;
+         suffix < nold - j && suffix < nnew - j
+      && od[nold - 1 - suffix] == nd[nnew - 1 - suffix]
+      ;  ++suffix
+   ) {}
+   oend= nold - suffix; nend= nnew - suffix;
+   delta_op(op_copy, j, 0);
+   base= i= lit= j;
+   if (nblocks= (oend - base) / DELTA_BLOCK) {
+      size_t b;
+      /* The bucket numbers are taken from 32 bit hash values. */
+      while (bits < 32 && (size_t)1 << bits < nblocks) ++bits;
+      if (
+            !(block_head= calloc((size_t)1 << bits, sizeof *block_head))
+         || !(block_next= malloc(nblocks * sizeof *block_next))
+      ) {
+         die("Memory allocation error!");
+      }
+      /* Link the blocks of every bucket in ascending order, as 1-based
+       * block numbers. */
+      for (b= nblocks; b--; ) {
+         size_t *const head= block_head + block_bucket(
+            block_hash(od + base + b * DELTA_BLOCK), bits
+         );
+         block_next[b]= *head; *head= b + 1;
+      }
+      for (b= 1; b < DELTA_BLOCK; ++b) top= top * 257 & 0xffffffff;
+   }
+   while (nend - j >= DELTA_BLOCK) {
+      size_t best= 0, from= 0;
+      {
+         /* Try to continue in step, as if the bytes since <lit> had
+          * replaced the same number of old bytes. */
+         size_t const p= i + (j - lit);
+         if (p < oend && od[p] == nd[j]) {
+            size_t const n= match_len(
+               od + p, nd + j, oend - p < nend - j ? oend - p : nend - j
+            );
+            if (n >= DELTA_STEP_MIN) { best= n; from= p; }
+         }
+      }
+      if (nblocks) {
+         size_t *head, e;
+         int left= DELTA_CANDIDATES;
+         if (rehash) { h= block_hash(nd + j); rehash= 0; }
+         head= block_head + block_bucket(h, bits);
+         /* Blocks before the current old position will never be used
+          * again. */
+         while (*head && base + (*head - 1) * DELTA_BLOCK < i) {
+            *head= block_next[*head - 1];
+         }
+         for (e= *head; e && left--; e= block_next[e - 1]) {
+            size_t const p= base + (e - 1) * DELTA_BLOCK;
+            if (!memcmp(od + p, nd + j, DELTA_BLOCK)) {
+               size_t const n= DELTA_BLOCK + match_len(
+                     od + p + DELTA_BLOCK, nd + j + DELTA_BLOCK
+                  ,  (oend - p < nend - j ? oend - p : nend - j)
+                     - DELTA_BLOCK
+               );
+               if (n > best) { best= n; from= p; }
+            }
+         }
+      }
+      if (best) {
+         /* Extend the match backwards as far as possible. */
+         size_t p= from, q= j;
+         while (q > lit && p > i && od[p - 1] == nd[q - 1]) { --p; --q; }
+         delta_edit(p - i, nd + lit, q - lit);
+         delta_op(op_copy, from + best - p, 0);
+         i= from + best; lit= j+= best;
+         rehash= 1;
+      } else {
+         if (nblocks && nend - j > DELTA_BLOCK) {
+            /* Roll the hash forward by one byte. */
+            h= (
+                  (h - (unsigned char)nd[j] * top) * 257
+               +  (unsigned char)nd[j + DELTA_BLOCK]
+            ) & 0xffffffff;
+         }
+         ++j;
+      }
+   }
+   delta_edit(oend - i, nd + lit, nend - lit);
+   delta_op(op_copy, suffix, 0);
+   delta_op(op_end, 0, 0);
+}
+
+/* Implements mode -D, applying the delta read from the input stream to
+ * <base_fp>. */
+static void apply_delta(void) {
+   unsigned long old_size, new_size, old_hash[2], new_hash[2];
+   unsigned long osize= 0, nsize= 0, oh[2], nh[2];
+   int op, mismatch= 0;
+   {
+      size_t i;
+      for (i= 0; i < sizeof delta_magic - sizeof(char); ++i) {
+         if (ck_bgetc() != (unsigned char)delta_magic[i]) {
+            die("Input is not a delta created by option -d!");
+         }
+      }
+   }
+   old_size= get_varint(); get_hash(old_hash);
+   new_size= get_varint(); get_hash(new_hash);
+   {
+      /* Detect the wrong old file before writing anything, if possible. */
+      long size;
+      if (!fseek(base_fp, 0, SEEK_END) && (size= ftell(base_fp)) >= 0) {
+         if ((unsigned long)size != old_size) mismatch= 1;
+         if (fseek(base_fp, 0, SEEK_SET)) die("Could not rewind old file!");
+      }
+   }
+   oh[0]= nh[0]= 0xcbf29ce4; oh[1]= nh[1]= 0x84222325;
+   while (!mismatch && (op= get_delta_byte()) != op_end) {
+      unsigned long len;
+      if (op > op_delete) die("Invalid operation in delta!");
+      len= get_varint();
+      if (op != op_insert) {
+         unsigned long left= len;
+         osize+= len;
+         while (left) {
+            char buf[BUFSIZ];
+            size_t const n= left < sizeof buf ? (size_t)left : sizeof buf;
+            if (fread(buf, sizeof(char), n, base_fp) != n) {
+               if (ferror(base_fp)) {
+                  die("Error reading file \"%s\"!", delta_base);
+               }
+               mismatch= 1;
+               break;
+            }
+            fnv1a64(oh, buf, n);
+            if (op == op_copy) {
+               fnv1a64(nh, buf, n);
+               ck_write(buf, n);
+            }
+            left-= (unsigned long)n;
+         }
+      }
+      if (op != op_delete) nsize+= len;
+      if (op == op_insert || op == op_replace) {
+         while (len) {
+            size_t n;
+            if (!(n= in_avail())) die("Unexpected end of delta!");
+            if (n > len) n= (size_t)len;
+            fnv1a64(nh, in_buf + in_pos, n);
+            ck_write(in_buf + in_pos, n);
+            in_skip(n);
+            len-= (unsigned long)n;
+         }
+      }
+   }
+   if (
+         mismatch || osize != old_size || getc(base_fp) != EOF
+      || oh[0] != old_hash[0] || oh[1] != old_hash[1]
+   ) {
+      die("The delta has not been created for file \"%s\"!", delta_base);
+   }
+   if (
+         nsize != new_size || nh[0] != new_hash[0] || nh[1] != new_hash[1]
+      || ck_bgetc() != EOF
+   ) {
+      die("The delta is corrupt!");
+   }
+}
+
+static int actual_main(int argc, char **argv);
+
+/* Implements mode -F. Every request is processed by actual_main() as if it
+ * were a separate invocation of the program, but with temporary files
+ * replacing the standard streams. */
+static void serve(char *app) {
+   FILE *const requests= in_fp, *const responses= out_fp;
+   FILE *const errors= err_fp;
+   for (;;) {
+      unsigned long nargs, nbytes;
+      char **argv;
+      FILE *req_in, *req_out, *req_err;
+      int status;
+      jmp_buf on_error;
+      /* Options given to the invocation of -F itself must not affect any
+       * request. */
+      cleanup();
+      {
+         int n;
+         if ((n= fscanf(requests, "%lu %lu", &nargs, &nbytes)) == EOF) {
+            if (ferror(requests)) die("Error reading request frame!");
+            break; /* No more requests. */
+         }
+         if (n != 2 || getc(requests) != '\n') {
+            die("Invalid request frame header!");
+         }
+      }
+      if (
+            nargs >= INT_MAX || nargs >= (size_t)-1 / sizeof *argv - 1
+         || !(argv= malloc((size_t)(nargs + 2) * sizeof *argv))
+      ) {
+         die("Memory allocation error!");
+      }
+      argv[0]= app;
+      {
+         unsigned long i;
+         for (i= 1; i <= nargs; ++i) {
+            char line[FILENAME_MAX + 2];
+            size_t len;
+            if (!fgets(line, (int)sizeof line, requests)) {
+               die("Unexpected end of request frame!");
+            }
+            if ((len= strlen(line)) == 0 || line[len - 1] != '\n') {
+               die("Request argument too long!");
+            }
+            line[--len]= '\0';
+            if (!(argv[i]= malloc(len + 1))) die("Memory allocation error!");
+            (void)strcpy(argv[i], line);
+         }
+         argv[i]= 0;
+      }
+      if (
+            !(req_in= tmpfile()) || !(req_out= tmpfile())
+         || !(req_err= tmpfile())
+      ) {
+         die("Could not create temporary file!");
+      }
+      copy_frame_data(requests, req_in, nbytes);
+      rewind(req_in);
+      in_fp= req_in; out_fp= req_out; err_fp= req_err;
+      read_pos= 0; in_pos= in_len= 0;
+      die_jmp= &on_error;
+      if (setjmp(on_error)) {
+         status= EXIT_FAILURE;
+      } else {
+         status= actual_main((int)nargs + 1, argv);
+      }
+      die_jmp= 0;
+      cleanup();
+      /* actual_main() may have replaced <req_in> by reopening it. */
+      req_in= in_fp;
+      in_fp= requests; out_fp= responses; err_fp= errors;
+      {
+         FILE *const result= status == EXIT_SUCCESS ? req_out : req_err;
+         long size;
+         if (fflush(result) || (size= ftell(result)) < 0) {
+            die("Error writing to temporary file!");
+         }
+         rewind(result);
+         ck_printf("%d %ld\n", status != EXIT_SUCCESS, size);
+         copy_frame_data(result, responses, (unsigned long)size);
+         if (fflush(responses)) output_error();
+      }
+      if (req_in) (void)fclose(req_in);
+      (void)fclose(req_out);
+      (void)fclose(req_err);
+      {
+         unsigned long i;
+         for (i= 1; i <= nargs; ++i) free(argv[i]);
+      }
+      free(argv);
+   }
+}
+
 static int actual_main(int argc, char **argv) {
    int mode= 'w';
    unsigned units_per_line= 1;
    int ascii_dump, terminate_ws;
+   char const *record_spec= "0";
    ascii_dump= terminate_ws= 0;
    if (argc > 1) {
       int optind= 1, argpos;
@@ -332,12 +1718,13 @@ static int actual_main(int argc, char **argv) {
          switch (c) {
             case 'W': case 'C': case 'X': case 'B':
             case 'w': case 'c': case 'x': case 'b':
-            case 's':
+            case 's': case 'F':
                mode= c;
                break;
             case 'a': ascii_dump= 1; break;
             case 't': terminate_ws= 1; break;
-            case 'n':
+            case 'n': case 'k': case 'u': case 'o': case 'l':
+            case 'd': case 'D': case 'r': case 'm': case 'p':
                if (!arg[++argpos]) {
                   if (++optind == argc) {
                      die("Missing argument for option -%c!", c);
@@ -345,6 +1732,38 @@ static int actual_main(int argc, char **argv) {
                   arg= argv[optind];
                   argpos= 0;
                }
+               /* Options with string arguments. */
+               switch (c) {
+                  case 'k': {
+                     char *colon;
+                     cache_dir= arg + argpos;
+                     cache_entries= CONFIG_CACHE_ENTRIES;
+                     if (
+                           (colon= strrchr(cache_dir, ':')) && colon[1]
+                        && !colon[1 + strspn(colon + 1, "0123456789")]
+                     ) {
+                        /* Also a valid directory name on most platforms,
+                         * but not a likely one. */
+                        if (!(cache_entries= strtoul(colon + 1, 0, 10))) {
+                           goto invalid_argument;
+                        }
+                        *colon= '\0';
+                     }
+                     goto next_arg;
+                  }
+                  case 'd': case 'D':
+                     mode= c;
+                     delta_base= arg + argpos;
+                     goto next_arg;
+                  case 'm': merge_name= arg + argpos; goto next_arg;
+                  case 'p': split_prefix= arg + argpos; goto next_arg;
+                  case 'r':
+                     free(fields); fields= 0;
+                     if (!parse_fields(record_spec= arg + argpos)) {
+                        goto invalid_argument;
+                     }
+                     goto next_arg;
+               }
                {
                   unsigned long optval;
                   {
@@ -358,9 +1777,29 @@ static int actual_main(int argc, char **argv) {
                         );
                      }
                   }
-                  units_per_line= (unsigned)optval;
-                  if (units_per_line != optval || units_per_line < 1) {
-                     goto invalid_argument;
+                  /* Options with numeric arguments. */
+                  switch (c) {
+                     case 'o':
+                        range_offset= optval;
+                        break;
+                     case 'l':
+                        range_left= optval; range_limited= 1;
+                        break;
+                     case 'u':
+                        latency_ms= (long)optval;
+                        if (
+                              latency_ms < 0
+                           || (unsigned long)latency_ms != optval
+                        ) {
+                           goto invalid_argument;
+                        }
+                        break;
+                     default:
+                        assert(c == 'n');
+                        units_per_line= (unsigned)optval;
+                        if (units_per_line != optval || units_per_line < 1) {
+                           goto invalid_argument;
+                        }
                   }
                }
                goto next_arg;
@@ -377,50 +1816,172 @@ static int actual_main(int argc, char **argv) {
       end_of_options:
       if (optind < argc) {
          char const *fname= argv[optind++];
-         char const *fmode= strchr("xb", mode) ? "rb" : "r";
-         if (!freopen(fname, fmode, stdin)) {
+         char const *fmode= strchr("xbFdD", mode) ? "rb" : "r";
+         if (!(in_fp= freopen(fname, fmode, in_fp))) {
             die("Could not open file \"%s\" in mode \"%s\"!", fname, fmode);
          }
       }
       if (optind != argc) die("Too many arguments!");
    }
+   switch (mode) {
+      case 'F': break;
+      case 'X': case 'B':
+         /* Patch the decoded bytes into the specified range of the output
+          * stream. */
+         if (range_offset && seek_offset(out_fp, range_offset)) {
+            die("Could not seek to offset %lu of output!", range_offset);
+         }
+         decode_limited= range_limited; decode_left= range_left;
+         range_limited= 0;
+         if (merge_name) {
+            if (!record_size) die("Option -m requires option -r!");
+            if (!(merge_fp= fopen(merge_name, "rb"))) {
+               die("Could not open file \"%s\" in mode \"rb\"!", merge_name);
+            }
+            if (
+                  range_offset
+               && seek_offset(merge_fp, range_offset)
+            ) {
+               die(
+                     "Could not seek to offset %lu of file \"%s\"!"
+                  ,  range_offset, merge_name
+               );
+            }
+            fld_first= 0; fld_last= nfields;
+            fields_seek(range_offset);
+         }
+         break;
+      case 'x': case 'b':
+         if (split_prefix && !record_size) {
+            die("Option -p requires option -r!");
+         }
+         /* Fall through. */
+      default: if (range_offset) range_seek_input();
+   }
+   if (latency_ms >= 0) {
+      if (cache_dir) die("Options -k and -u cannot be combined!");
+      #if CONFIG_POSIX
+         stream_flush();
+      #else
+         if (setvbuf(out_fp, 0, _IOLBF, BUFSIZ)) internal_error();
+      #endif
+   }
+   if (
+         cache_dir && (
+               mode == 'd' || mode == 'D' || merge_fp
+            || split_prefix && strchr("xb", mode)
+         )
+   ) {
+      die("Option -k is not supported for -d, -D, -m and -p!");
+   }
+   if (cache_dir && mode != 'F') {
+      char const *ctype;
+      int hit;
+      #if CONFIG_NO_LOCALE
+         ctype= "-";
+      #else
+         if (!(ctype= setlocale(LC_CTYPE, 0))) ctype= "-";
+      #endif
+      if (!(cache_key= malloc(strlen(ctype) + strlen(record_spec) + 128))) {
+         die("Memory allocation error!");
+      }
+      (void)sprintf(
+            cache_key, "-%c -n%u -a%d -t%d -o%lu -l%lu -r%s %s"
+         ,  mode, units_per_line, ascii_dump, terminate_ws, range_offset
+         ,     range_limited ? range_left
+            :  decode_limited ? decode_left
+            :  ULONG_MAX
+         ,  record_spec, ctype
+      );
+      hit= cache_lookup(cache_key);
+      free(cache_key); cache_key= 0;
+      if (hit) goto done;
+   }
    /* Reset initial multibyte character conversion shift state - just to be
     * sure. */
    (void)mbtowc(0, 0, 0);
    switch (mode) {
+      case 'F':
+         if (die_jmp) die("Option -F is not supported within requests!");
+         serve(argv[0]);
+         goto done;
+      case 'd': case 'D': {
+         size_t nold, nnew;
+         if (!(base_fp= fopen(delta_base, "rb"))) {
+            die("Could not open file \"%s\" in mode \"rb\"!", delta_base);
+         }
+         if (mode == 'D') {
+            apply_delta();
+         } else {
+            old_data= read_all(base_fp, &nold);
+            new_data= read_all(in_fp, &nnew);
+            make_delta(nold, nnew);
+         }
+         goto done;
+      }
       case 'x': case 'b':
-         if (ascii_dump) {
-            assert(units_per_line >= 1);
-            if (
-               !(
-                  dump_buf= malloc(
-                        mode == 'b'
-                     ?  (
-                           /* The maximum number of whole characters which
-                            * could be produced by the bits left of the text
-                            * dump area plus another byte for pre-caching the
-                            * next byte to be processed, even if no more than
-                            * the first bit of it has already been included
-                            * in <dump_bits> so far. In other words,
-                            * <dump_buf> needs to provide CHAR_BIT - 1 bits
-                            * more space than <dump_bits> will ever tell. */
-                           (units_per_line + CHAR_BIT - 1) / CHAR_BIT
-                        )
-                           /* Plus one character more, because it is possible
-                            * that a partial byte from the line before became
-                            * a whole byte which will also be dumped here. */
-                        +  1
-                     :  units_per_line
-                  )
-               )
-            ) {
-               die("Memory allocation error!");
+         fld_first= 0; fld_last= nfields;
+         if (split_prefix) {
+            /* Dump one field after the other, each into a file of its own,
+             * by re-reading the input. */
+            if ((split_start= file_tell(in_fp)) < 0) {
+               die("Option -p requires a seekable input file!");
             }
+            split_left= range_left;
+            fld_last= 0;
          }
+         next_field:
+         if (split_prefix) {
+            char name[FILENAME_MAX];
+            if (strlen(split_prefix) > sizeof name - 16) {
+               die("File name prefix for option -p is too long!");
+            }
+            fld_first= fld_last++;
+            (void)sprintf(name, "%s%u", split_prefix, fld_last);
+            if (!(split_fp= fopen(name, "w"))) {
+               die("Could not create file \"%s\"!", name);
+            }
+            split_out= out_fp; out_fp= split_fp;
+            if (fld_first) {
+               if (file_seek(in_fp, split_start, SEEK_SET)) {
+                  die("Could not rewind input!");
+               }
+               in_pos= in_len= 0; read_pos= 0;
+               range_left= split_left;
+            }
+         }
+         if (record_size) fields_seek(range_offset);
          {
             int ghost;
-            unsigned c_bits, dump_bits, unit;
-            c_bits= dump_bits= unit= 0;
+            /* <dump_part> is the number of bits of the latest character of
+             * the ASCII dump which have been dumped so far by -b, or 0 if
+             * it is complete. */
+            unsigned c_bits, dump_part, unit;
+            c_bits= dump_part= unit= 0;
+            dump_len= 0;
+            if (range_offset) {
+               /* Align the lines to the absolute offset of the range, by
+                * starting the first line with blanks in place of the units
+                * before the range. */
+               unsigned long start= range_offset % units_per_line;
+               if (record_size) {
+                  /* Only count the selected bytes before the range. */
+                  start= (
+                        mulmod(
+                              range_offset / record_size
+                           ,  fields_before(record_size), units_per_line
+                        )
+                     +  fields_before(range_offset % record_size)
+                        % units_per_line
+                  ) % units_per_line;
+               }
+               if (mode == 'b') start= mulmod(start, CHAR_BIT, units_per_line);
+               for (; unit < start; ++unit) {
+                  if (unit) ck_putc(DUMP_UNIT_SEP);
+                  ck_putc(' ');
+                  if (mode == 'x') ck_putc(' ');
+               }
+            }
             for (ghost= 0;; ) {
                unsigned c;
                #ifndef NDEBUG
@@ -434,7 +1995,7 @@ static int actual_main(int argc, char **argv) {
                   /* Not at EOF yet. */
                   if (c_bits < CHAR_BIT) {
                      int byte;
-                     if ((byte= ck_getc()) == EOF) {
+                     if ((byte= field_bgetc()) == EOF) {
                         ghost= 1; /* Daddy, I can see DEAD BYTES! */
                         continue;
                      }
@@ -444,11 +2005,14 @@ static int actual_main(int argc, char **argv) {
                   }
                } else {
                   /* EOF has already been reached. Should we linger around? */
-                  if (unit == 0 && c_bits == 0 && dump_bits < CHAR_BIT) {
+                  if (
+                        unit == 0 && c_bits == 0
+                     && dump_len <= (unsigned long)(dump_part != 0)
+                  ) {
                      /* We are done! Less than CHAR_BIT trailing bits after
                       * the last full byte will be ignored for mode "-b",
                       * because we cannot display a partial character. */
-                     goto done;
+                     break;
                   }
                }
                if (unit) ck_putc(DUMP_UNIT_SEP);
@@ -457,13 +2021,13 @@ static int actual_main(int argc, char **argv) {
                      case 'b':
                         ck_putc(c & 1 << c_bits - 1 ? '1' : '0');
                         if (ascii_dump) {
-                           if (dump_bits % CHAR_BIT == 0) {
+                           if (dump_part == 0) {
                               assert(c_bits >= CHAR_BIT);
-                              dump_buf[dump_bits / CHAR_BIT]=
-                                 (char)(c >> c_bits - CHAR_BIT)
-                              ;
+                              dump_put(
+                                 (int)(c >> c_bits - CHAR_BIT & UCHAR_MAX)
+                              );
                            }
-                           ++dump_bits;
+                           if (++dump_part == CHAR_BIT) dump_part= 0;
                         }
                         --c_bits;
                         break;
@@ -471,10 +2035,7 @@ static int actual_main(int argc, char **argv) {
                         assert(c_bits == CHAR_BIT);
                         c&= (1 << CHAR_BIT) - 1;
                         ck_printf("%02X", c);
-                        if (ascii_dump) {
-                           dump_buf[unit]= (char)c;
-                           dump_bits+= CHAR_BIT;
-                        }
+                        if (ascii_dump) dump_put((int)c);
                         c_bits= 0;
                      }
                   }
@@ -486,45 +2047,33 @@ static int actual_main(int argc, char **argv) {
                }
                assert(unit < units_per_line);
                if (++unit == units_per_line) {
-                  if (ascii_dump) {
-                     unsigned ndump;
-                     if (ndump= dump_bits >> 3) {
-                        unsigned i;
-                        ck_putc(ASCII_DUMP_SEP);
-                        for (i= 0; i < ndump; ++i) {
-                           int c;
-                           ck_putc(
-                              (c= dump_buf[i]) >= 0x20 && c < 0x7f ? c : '.'
-                           );
-                        }
-                        if (dump_bits & 8 - 1) {
-                           /* There are left-over unprocessed bits. Move them
-                            * to the beginning of the buffer. */
-                           dump_buf[0]= dump_buf[ndump];
-                        }
-                        assert(dump_bits >= ndump << 3);
-                        dump_bits-= ndump << 3;
-                     }
-                     assert(dump_bits < 8);
-                  }
+                  /* A partially dumped character will be completed and
+                   * output in the next line. */
+                  if (ascii_dump) dump_flush(dump_part != 0);
                   unit= 0;
                   ck_putc('\n');
                }
             }
          }
-         break;
+         if (split_prefix) {
+            FILE *const f= split_fp;
+            out_fp= split_out; split_out= 0; split_fp= 0;
+            if (fclose(f)) output_error();
+            if (fld_last < nfields) goto next_field;
+         }
+         goto done;
       case 'X':
          {
             auto unsigned int b;
             int n;
             errno= 0;
             for (;;) {
-               if ((n= scanf("%2x", &b)) == 1) {
-                  if (putchar((int)b) == EOF) stdout_error();
+               if ((n= fscanf(in_fp, "%2x", &b)) == 1) {
+                  put_decoded((int)b);
                } else {
                   if (n == EOF) {
-                     ck_stdin();
-                     if (feof(stdin)) break;
+                     ck_input();
+                     if (feof(in_fp)) break;
                   }
                   if (!ignore_line_suffix()) break;
                }
@@ -551,46 +2100,99 @@ static int actual_main(int argc, char **argv) {
                }
                byte|= c;
             }
-            if (putchar(byte) == EOF) stdout_error();
-         } while (!feof(stdin));
+            put_decoded(byte);
+         } while (!feof(in_fp));
          goto done;
       }
    }
    {
-      /* In -c and -w encodings, the following whitespace characters are
-       * transformed into a sequence of 1 to 6 consecutive SPACE characters,
-       * terminated by HT. The length of the sequence corresponds to the
-       * 1-based character position in the string below. As a special
-       * abbreviation rule, SPACE and HT in the transformed output which do
-       * not match the above pattern represent themselves literally. */
-      char const wse[]= {"\012\040\015\011\014\013"};
-      int const lit_SPACE= '\040'; /* SPACE of explanation above. */
-      int const lit_HT= '\011'; /* HT of explanation above. */
+      int const lit_SPACE= '\040'; /* SPACE of explanation at wse[]. */
+      int const lit_HT= '\011'; /* HT of explanation at wse[]. */
       unsigned const SPACE_enc= (int)(strchr(wse, lit_SPACE) + 1 - wse);
-      #ifndef NDEBUG
-      unsigned const HT_enc= (int)(strchr(wse, lit_HT) + 1 - wse);
-      #endif
+      int const SPACE_cls= cc_wse + (int)SPACE_enc - 1;
+      int const HT_cls= cc_wse + (int)(strchr(wse, lit_HT) - wse);
+      int const NL_cls= cc_wse + (int)(strchr(wse, '\n') - wse);
       size_t const mb_cur_max= MB_CUR_MAX;
+      /* All modes except -c copy runs of characters which cannot affect
+       * their state machines directly from the input buffer to the output.
+       * This requires a character set without shift states, where every
+       * character can be classified without knowing what precedes it. With
+       * a single-byte character set, the state machines also classify
+       * characters by looking up <char_class>. */
+      int const fast_runs=
+         mode != 'c' && (mb_cur_max == 1 || !mbtowc(0, 0, 0))
+      ;
       enum {
          st_initial, st_word, st_space, st_otherws, st_skip
       } state= st_initial;
       char c[MB_LEN_MAX];
       size_t nc0, nc= 0;
-      int nnul, b, eof= 0;
+      int nnul, b, cls, eof= 0;
       unsigned nsp;
-      wchar_t wc;
       assert(SPACE_enc >= 1 && SPACE_enc <= sizeof wse - 1);
-      assert(HT_enc >= 1 && HT_enc <= sizeof wse - 1);
+      assert(HT_cls >= cc_wse && HT_cls < cc_wse + (int)sizeof wse - 1);
       {
          /* Determine the length of the MBCS-encoding of L'\0'. */
          char nul[MB_LEN_MAX];
          if ((nnul= wctomb(nul, L'\0')) < 1) die("Unsupported locale!");
       }
+      if (fast_runs || mb_cur_max == 1) init_char_class();
       for (;;) {
+         if (fast_runs && !nc) {
+            size_t n, i, len;
+            /* The highest class of the characters which can be copied. */
+            int run_cls= -1;
+            if (mode == 'w') {
+               /* Continue the current word. */
+               if (state == st_word) run_cls= cc_term;
+            } else {
+               switch (state) {
+                  case st_skip:
+                     /* Skip everything up to the next newline. Invalid
+                      * characters are left to the state machine, so that
+                      * the error will be reported as usual. */
+                     while (n= in_avail()) {
+                        for (i= 0; i < n; i+= len) {
+                           len= char_at(in_buf + in_pos + i, n - i, &cls);
+                           if (!len || cls == NL_cls) break;
+                        }
+                        in_skip(i);
+                        if (i < n) break;
+                     }
+                     break;
+                  case st_space:
+                     /* Pending SPACEs in modes -W and -C still need to be
+                      * decoded one by one. */
+                     if (mode != 's') break;
+                     /* Fall through. */
+                  case st_initial: case st_otherws:
+                     /* Copy 'word' characters other than '$'. */
+                     run_cls= cc_word;
+                  default: break;
+               }
+            }
+            if (run_cls >= 0) {
+               /* Copy characters up to the next byte which needs a closer
+                * look. That byte will then be processed by the state machine
+                * below. */
+               while (n= in_avail()) {
+                  for (i= 0; i < n; i+= len) {
+                     len= char_at(in_buf + in_pos + i, n - i, &cls);
+                     if (!len || cls > run_cls) break;
+                  }
+                  if (i) {
+                     ck_write(in_buf + in_pos, i);
+                     in_skip(i);
+                     if (mode != 'w') state= st_initial;
+                  }
+                  if (i < n) break;
+               }
+            }
+         }
          /* Read as much bytes into c[] as possible, but not more than the
           * longest possible MBCS-sequence. */
          while (!eof && nc < mb_cur_max) {
-            if ((b= ck_getc()) == EOF) {
+            if ((b= ck_bgetc()) == EOF) {
                eof= 1;
                break;
             }
@@ -600,7 +2202,12 @@ static int actual_main(int argc, char **argv) {
             assert(eof);
             break;
          }
-         {
+         if (mb_cur_max == 1) {
+            if ((cls= char_class[(unsigned char)c[0]]) == cc_invalid) {
+               die("Illegal character encoding encountered!");
+            }
+            nc0= 1;
+         } else {
             int r;
             auto wchar_t wcbuf; /* Address will be taken. */
             if ((r= mbtowc(&wcbuf, c, nc)) == -1) {
@@ -613,8 +2220,7 @@ static int actual_main(int argc, char **argv) {
             if (r == 0) r= nnul;
             assert(r > 0);
             assert((size_t)r <= nc);
-            /* In contrary to <wcbuf>, <wc> might be a register variable. */
-            wc= wcbuf;
+            cls= classify(wcbuf);
             nc0= (size_t)r;
          }
          switch (mode) {
@@ -624,7 +2230,7 @@ static int actual_main(int argc, char **argv) {
                 * st_word: Not after a whitespace sequence.
                 * st_space: After <nsp> lit_SPACE characters yet to be output.
                 * st_otherws: After any other kind of whitespace character. */
-               if (wc == (wchar_t)lit_SPACE) {
+               if (cls == SPACE_cls) {
                   switch (state) {
                      case st_space:
                         assert(nsp + 1 > nsp); /* No overflow. */
@@ -632,7 +2238,7 @@ static int actual_main(int argc, char **argv) {
                         break;
                      default: nsp= 1; state= st_space;
                   }
-               } else if (wc == (wchar_t)lit_HT) {
+               } else if (cls == HT_cls) {
                   switch (state) {
                      default: assert(state == st_otherws); break;
                      case st_space:
@@ -653,23 +2259,13 @@ static int actual_main(int argc, char **argv) {
                    * encoding. */
                   ck_putc(lit_HT);
                   assert(state == st_otherws);
-               } else if (iswspace(wc)) {
+               } else if (cls >= cc_otherws) {
                   /* Whitespace which cannot use an abbreviated literal form
                    * if it needs encoding. */
-                  union {
-                     unsigned enc;
-                     char const *found;
-                     ptrdiff_t offset;
-                  } u;
-                  if (
-                     wc < (wchar_t)128 /* ASCII? */
-                     && (u.found= strchr(wse, (char)(unsigned char)wc))
-                  ) {
+                  if (cls >= cc_wse) {
                      /* A whitespace character which needs to be encoded. */
-                     u.offset= u.found - wse;
-                     assert(u.offset >= 0 && (size_t)u.offset < sizeof wse);
-                     u.enc= (unsigned)u.offset + 1;
-                     assert(u.enc >= 1 && u.enc <= sizeof wse - 1);
+                     unsigned enc= (unsigned)(cls - cc_wse) + 1;
+                     assert(enc >= 1 && enc <= sizeof wse - 1);
                      switch (state) {
                         case st_space:
                            /* Whitespace which needs encoding following
@@ -687,8 +2283,8 @@ static int actual_main(int argc, char **argv) {
                            /* Fall through. */
                         default: {
                            assert(state == st_otherws);
-                           /* Encode <wc> itself. */
-                           do ck_putc(lit_SPACE); while (--u.enc);
+                           /* Encode the character itself. */
+                           do ck_putc(lit_SPACE); while (--enc);
                            ck_putc(lit_HT);
                         }
                      }
@@ -707,13 +2303,14 @@ static int actual_main(int argc, char **argv) {
                            /* Fall through. */
                         default: {
                            assert(state == st_otherws);
-                           ck_write(c, nc0); /* Output <wc> literally. */
+                           /* Output the character literally. */
+                           ck_write(c, nc0);
                         }
                      }
                   }
                   assert(state == st_otherws);
                } else {
-                  /* <wc> is a 'word' character. */
+                  /* A 'word' character. */
                   switch (state) {
                      case st_word:
                         if (mode == 'c') goto terminate;
@@ -740,7 +2337,7 @@ static int actual_main(int argc, char **argv) {
                         /* Fall through. */
                      default: state= st_word;
                   }
-                  ck_write(c, nc0); /* Output <wc> literally. */
+                  ck_write(c, nc0); /* Output it literally. */
                }
                break;
             case 's':
@@ -748,14 +2345,16 @@ static int actual_main(int argc, char **argv) {
                 * st_initial: At the beginning of a line or within a word.
                 * st_space: After whitespace (other than newline).
                 * st_skip: Ignore rest of input line.  */
-               if (wc == L'\n') state= st_initial;
+               if (cls == NL_cls) state= st_initial;
                if (state != st_skip) {
-                  if (wc == (wchar_t)WS_OPT_TERMINATOR && state == st_space) {
+                  if (cls == cc_term && state == st_space) {
                      state= st_skip;
                      break;
                   }
                   ck_write(c, nc0);
-                  state= iswspace(wc) && wc != L'\n' ? st_space : st_initial;
+                  state= cls >= cc_otherws && cls != NL_cls
+                     ?  st_space : st_initial
+                  ;
                }
                break;
             default: {
@@ -766,10 +2365,10 @@ static int actual_main(int argc, char **argv) {
                 * st_otherws: After whitespace but not in mode st_space.
                 * st_skip: Ignore rest of input line.  */
                if (state == st_skip) {
-                  if (wc == L'\n') state= st_initial;
+                  if (cls == NL_cls) state= st_initial;
                   break;
                }
-               if (wc == (wchar_t)lit_SPACE) {
+               if (cls == SPACE_cls) {
                   if (state != st_space) {
                      assert(state == st_initial || state == st_otherws);
                      nsp= 1;
@@ -791,7 +2390,7 @@ static int actual_main(int argc, char **argv) {
                } else {
                   /* Some other character than a SPACE. */
                   if (state == st_space) {
-                     if (wc == (wchar_t)lit_HT) {
+                     if (cls == HT_cls) {
                         /* It is an encoded whitespace character. Decode it. */
                         assert(nsp >= 1 && nsp <= sizeof wse - 1);
                         ck_putc(wse[nsp - 1]);
@@ -805,25 +2404,29 @@ static int actual_main(int argc, char **argv) {
                      state= st_otherws;
                   }
                   assert(state == st_initial || state == st_otherws);
-                  if (wc == L'\n') {
+                  if (cls == NL_cls) {
                      state= st_initial;
                      break;
                   }
-                  if (
-                     wc == (wchar_t)WS_OPT_TERMINATOR && state != st_initial
-                  ) {
+                  if (cls == cc_term && state != st_initial) {
                      assert(state == st_otherws);
                      state= st_skip;
                      break;
                   }
                   ck_write(c, nc0);
-                  state= iswspace(wc) ? st_otherws : st_initial;
+                  state= cls >= cc_otherws ? st_otherws : st_initial;
                }
             }
          }
          assert(nc0 <= nc);
          if (nc0 < nc) (void)memmove(c, c + nc0, nc - nc0);
          nc-= nc0;
+         if (fast_runs && !eof && nc <= in_pos) {
+            /* Return the remaining look-ahead bytes to the input buffer, so
+             * that the next run can be copied from there. */
+            in_unskip(nc);
+            nc= 0;
+         }
       }
       switch (mode) {
          case 'w': case 'c': {
@@ -841,6 +2444,10 @@ static int actual_main(int argc, char **argv) {
       }
    }
    done:
+   if (merge_fp && merge_advance()) {
+      die("Less data has been decoded than there are selected bytes!");
+   }
+   if (cache_fp) cache_store();
    if (fflush(0)) die("Error writing to output stream!");
    return EXIT_SUCCESS;
 }
@@ -858,6 +2465,7 @@ int main(int argc, char **argv) {
    #if !CONFIG_NO_LOCALE
       (void)setlocale(LC_ALL, "");
    #endif
+   in_fp= stdin; out_fp= stdout; err_fp= stderr;
    atexit(cleanup);
    return actual_main(argc, argv);
 }